@@ -131,6 +131,35 @@ bool Logger::openNewLogFile() {
     return true;
 }
 
+bool Logger::stop(std::chrono::milliseconds timeout, size_t& dropped) {
+    dropped = 0;
+    if (!worker_thread_.joinable()) {
+        return true;
+    }
+
+    bool finished;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        running_ = false;
+        condition_.notify_one();
+
+        finished = done_condition_.wait_for(lock, timeout,
+                                            [this] { return worker_done_; });
+        if (!finished) {
+            // Поток завершится, как только допишет текущее сообщение
+            dropped = message_queue_.size();
+            std::queue<std::string>().swap(message_queue_);
+        }
+    }
+
+    if (finished) {
+        worker_thread_.join();
+    } else {
+        worker_thread_.detach();
+    }
+    return finished;
+}
+
 std::string Logger::formatMessage(const std::string& message) {
     std::stringstream ss;
     getCookedLogString(ss) << message;
@@ -139,6 +168,19 @@ std::string Logger::formatMessage(const std::string& message) {
 }
 
 void Logger::processQueue() {
+    // Привязываемся до открытия файла, чтобы буферы потока выделялись на
+    // локальном NUMA-узле
+    if (!pinCurrentThread(cpus_)) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_occurred_ = true;
+        }
+        error_promise_.set_exception(std::make_exception_ptr(LoggerException(
+            "Failed to pin logger thread to " + describeCpuSet(cpus_))));
+        return;
+    }
+    effective_cpus_ = getCurrentThreadAffinity();
+
     if (!openNewLogFile()) {
         {
             std::lock_guard<std::mutex> lock(mutex_);
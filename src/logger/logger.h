@@ -1,9 +1,12 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <future>
 #include <queue>
+#include <vector>
 
 class LoggerException : public std::exception {
    public:
@@ -31,13 +34,28 @@ class Logger {
 
     ~Logger() { stop(); }
 
+    // Набор CPU для рабочего потока, задаётся до start()
+    void setCpuAffinity(const std::vector<int>& cpus) { cpus_ = cpus; }
+
+    // Набор CPU, который ядро действительно назначило рабочему потоку.
+    // Заполняется до готовности future, возвращённого start()
+    const std::vector<int>& effectiveCpus() const { return effective_cpus_; }
+
     // Начало работы логгера с возвратом future для отслеживания ошибок
     std::future<void> start() {
         running_ = true;
         error_promise_ = std::promise<void>();
         auto future = error_promise_.get_future();
 
-        worker_thread_ = std::thread(&Logger::processQueue, this);
+        worker_done_ = false;
+        worker_thread_ = std::thread([this] {
+            processQueue();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                worker_done_ = true;
+            }
+            done_condition_.notify_all();
+        });
         return future;
     }
 
@@ -54,6 +72,13 @@ class Logger {
         }
     }
 
+    // Остановка с ограниченным ожиданием: очередь дописывается не дольше
+    // timeout. Если запись не успела завершиться, оставшиеся сообщения
+    // отбрасываются (их число возвращается в dropped), а рабочий поток
+    // отсоединяется - в этом случае объект нельзя разрушать, поток может
+    // ещё обращаться к нему. Возвращает true, если очередь записана полностью
+    bool stop(std::chrono::milliseconds timeout, size_t& dropped);
+
     // Добавление сообщения в очередь
     void log(const std::string& message) {
         {
@@ -68,19 +93,29 @@ class Logger {
 
     void operator<<(const std::string& message) { log(message); }
 
+    // Изменение максимального размера файла (в килобайтах) на лету.
+    // Новое значение учитывается при следующей записи
+    void setMaxFileSize(size_t max_file_size) {
+        max_file_size_ = max_file_size * 1024;
+    }
+
     bool hasError() const { return error_occurred_; }
 
    private:
     std::queue<std::string> message_queue_;
     std::mutex mutex_;
     std::condition_variable condition_;
+    std::condition_variable done_condition_;
     std::thread worker_thread_;
+    bool worker_done_{false};
     bool running_;
     bool error_occurred_;
     std::promise<void> error_promise_;
+    std::vector<int> cpus_;
+    std::vector<int> effective_cpus_;
 
     std::string base_filename_;
-    size_t max_file_size_;
+    std::atomic<size_t> max_file_size_;
     size_t current_file_number_{0};
     size_t current_file_size_;
     std::ofstream current_log_file_;
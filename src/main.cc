@@ -1,10 +1,181 @@
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 
 #include "logger/logger.h"
 #include "server/server.h"
 #include "utils.h"
 
+// Результат перечитывания конфигурации, подготовленный вне потока сервера
+struct PreparedReload {
+    std::shared_ptr<const ServerConfiguration> config;
+    // Новый адрес форвард-сервера или nullptr, если он не изменился
+    std::shared_ptr<const udp::endpoint> forward_endpoint;
+};
+
+// Связь потока перечитывания с потоком сервера. При остановке io обнуляется,
+// и поток, не успевший отдать результат, отбрасывает его. Поток при этом не
+// ждут: он может висеть в getaddrinfo
+struct ReloadChannel {
+    std::mutex mutex;
+    boost::asio::io_context* io = nullptr;
+};
+
+// Отвязывает поток перечитывания от io_context и отпускает его
+static void abandonReload(ReloadChannel& channel, std::thread& reload_thread) {
+    {
+        std::lock_guard<std::mutex> lock(channel.mutex);
+        channel.io = nullptr;
+    }
+    if (reload_thread.joinable()) {
+        reload_thread.detach();
+    }
+}
+
+// Выводит набор CPU, на котором реально работает поток. Ядро может сузить
+// запрошенный набор (например, по cpuset контейнера), об этом предупреждаем
+static void reportThreadCpus(const std::string& thread_name,
+                             const std::vector<int>& requested,
+                             const std::vector<int>& effective) {
+    std::stringstream ss;
+    getCookedLogString(ss)
+        << thread_name << " thread runs on "
+        << (requested.empty() ? describeCpuSet(requested)
+                              : describeCpuSet(effective))
+        << std::endl;
+    std::cout << ss.str();
+
+    if (!requested.empty() &&
+        std::set<int>(requested.begin(), requested.end()) !=
+            std::set<int>(effective.begin(), effective.end())) {
+        std::stringstream warning_ss;
+        getCookedLogString(warning_ss)
+            << "Warning: " << thread_name << " thread requested "
+            << describeCpuSet(requested) << ", kernel allowed "
+            << describeCpuSet(effective) << std::endl;
+        std::cerr << warning_ss.str();
+    }
+}
+
+// Перечитывает файл конфигурации и резолвит новый форвард-сервер. Выполняется
+// в отдельном потоке, чтобы разбор YAML и getaddrinfo не блокировали
+// обработку пакетов. Параметры, требующие пересоздания сокета, логгера или
+// потоков, отклоняются с сообщением. Если файл не разобран, возвращается
+// текущий снимок
+static PreparedReload prepareReload(
+    const std::shared_ptr<const ServerConfiguration>& current,
+    const std::string& conf_filename) {
+    // Разбираем так же, как при запуске: удалённые из файла поля получают
+    // значения по умолчанию, а не сохраняют текущие
+    ServerConfiguration fresh;
+
+    try {
+        parseServerConfiguration(fresh, conf_filename);
+    } catch (const ConfigurateException& e) {
+        std::stringstream ss;
+        getCookedLogString(ss) << "Reload failed: " << e.what()
+                               << ". Keeping current configuration."
+                               << std::endl;
+        std::cerr << ss.str();
+        return {current, nullptr};
+    }
+
+    if (fresh.port != current->port) {
+        std::stringstream ss;
+        getCookedLogString(ss)
+            << "Reload: port change (" << current->port << " -> "
+            << fresh.port << ") requires restart, ignored." << std::endl;
+        std::cerr << ss.str();
+        fresh.port = current->port;
+    }
+
+    if (fresh.base_filename != current->base_filename) {
+        std::stringstream ss;
+        getCookedLogString(ss)
+            << "Reload: log_filename change requires restart, ignored."
+            << std::endl;
+        std::cerr << ss.str();
+        fresh.base_filename = current->base_filename;
+    }
+
+    if (fresh.server_cpus != current->server_cpus ||
+        fresh.logger_cpus != current->logger_cpus) {
+        std::stringstream ss;
+        getCookedLogString(ss)
+            << "Reload: server_cpus/logger_cpus change requires restart, "
+               "ignored."
+            << std::endl;
+        std::cerr << ss.str();
+        fresh.server_cpus = current->server_cpus;
+        fresh.logger_cpus = current->logger_cpus;
+    }
+
+    std::shared_ptr<const udp::endpoint> forward_endpoint;
+    if (fresh.base_dns_ip != current->base_dns_ip ||
+        fresh.dns_server_port != current->dns_server_port) {
+        try {
+            forward_endpoint = DNSServer::resolveForwardAddress(
+                fresh.base_dns_ip, fresh.dns_server_port);
+        } catch (const std::exception& e) {
+            std::stringstream ss;
+            getCookedLogString(ss)
+                << "Reload: failed to resolve dns_server " << fresh.base_dns_ip
+                << ": " << e.what() << std::endl;
+            std::cerr << ss.str();
+            fresh.base_dns_ip = current->base_dns_ip;
+            fresh.dns_server_port = current->dns_server_port;
+        }
+    }
+
+    return {std::make_shared<const ServerConfiguration>(std::move(fresh)),
+            std::move(forward_endpoint)};
+}
+
+// Применяет подготовленную конфигурацию. Вызывается в потоке сервера и
+// только публикует готовые значения
+static void applyReload(const PreparedReload& reload,
+                        const ServerConfiguration& current, DNSServer& server,
+                        Logger& logger) {
+    const ServerConfiguration& fresh = *reload.config;
+
+    if (reload.forward_endpoint) {
+        server.setForwardEndpoint(reload.forward_endpoint);
+
+        std::stringstream ss;
+        getCookedLogString(ss)
+            << "Reload: dns_server set to " << fresh.base_dns_ip << ":"
+            << fresh.dns_server_port << std::endl;
+        std::cout << ss.str();
+    }
+
+    if (fresh.drain_timeout != current.drain_timeout) {
+        std::stringstream ss;
+        getCookedLogString(ss) << "Reload: drain_timeout set to "
+                               << fresh.drain_timeout << std::endl;
+        std::cout << ss.str();
+    }
+
+    if (fresh.log_flush_timeout != current.log_flush_timeout) {
+        std::stringstream ss;
+        getCookedLogString(ss) << "Reload: log_flush_timeout set to "
+                               << fresh.log_flush_timeout << std::endl;
+        std::cout << ss.str();
+    }
+
+    if (fresh.max_log_size != current.max_log_size) {
+        logger.setMaxFileSize(fresh.max_log_size);
+
+        std::stringstream ss;
+        getCookedLogString(ss) << "Reload: logfile_size set to "
+                               << fresh.max_log_size << std::endl;
+        std::cout << ss.str();
+    }
+}
+
 int main(int argc, char** argv) {
     if (argc < 2) {
         std::cerr << "Usage: DNSServer <config_file>" << std::endl;
@@ -21,13 +192,19 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    Logger* logger = nullptr;
-    DNSServer* server = nullptr;
-    boost::asio::io_context io_context;
+    // io_context объявлен первым, чтобы сокеты сервера закрывались раньше
+    // него. Создаётся после привязки потока сервера к CPU
+    std::unique_ptr<boost::asio::io_context> io_context_holder;
+    std::unique_ptr<Logger> logger;
+    std::unique_ptr<DNSServer> server;
+    // Поток, в котором готовится перечитанная конфигурация
+    std::thread reload_thread;
+    auto reload_channel = std::make_shared<ReloadChannel>();
 
     try {
-        logger =
-            new Logger(server_config.base_filename, server_config.max_log_size);
+        logger = std::make_unique<Logger>(server_config.base_filename,
+                                          server_config.max_log_size);
+        logger->setCpuAffinity(server_config.logger_cpus);
         auto future = logger->start();
 
         // Ждём успешной инициализации или ошибки
@@ -37,28 +214,153 @@ int main(int argc, char** argv) {
         getCookedLogString(ss) << "Logger started: " << std::endl;
         std::cout << ss.str();
 
+        reportThreadCpus("Logger", server_config.logger_cpus,
+                         logger->effectiveCpus());
+
+        // Исходный набор CPU процесса: поток перечитывания конфигурации
+        // создаётся из потока сервера и возвращается к этому набору, чтобы
+        // не конкурировать с обработкой пакетов
+        const std::vector<int> process_cpus = getCurrentThreadAffinity();
+
+        // Поток, выполняющий io_context, привязываем до создания io_context
+        // и сервера, чтобы их память в пространстве пользователя выделялась
+        // на локальном NUMA-узле. На буферы сокетов в ядре это не влияет
+        if (!pinCurrentThread(server_config.server_cpus)) {
+            throw std::runtime_error(
+                "Failed to pin server thread to " +
+                describeCpuSet(server_config.server_cpus));
+        }
+
+        io_context_holder = std::make_unique<boost::asio::io_context>();
+        boost::asio::io_context& io_context = *io_context_holder;
+        reload_channel->io = &io_context;
+
+        reportThreadCpus("Server", server_config.server_cpus,
+                         getCurrentThreadAffinity());
+
         boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
 
-        server = new DNSServer(server_config.port, io_context,
-                               server_config.base_dns_ip, *logger);
+        server = std::make_unique<DNSServer>(server_config.port, io_context,
+                                             server_config.base_dns_ip,
+                                             server_config.dns_server_port,
+                                             *logger);
+
+        // Снимок действующей конфигурации, заменяется при каждом SIGHUP
+        auto current_config =
+            std::make_shared<const ServerConfiguration>(server_config);
+        boost::asio::signal_set reload_signals(io_context, SIGHUP);
+        bool reload_in_progress = false;
+
+        // Вызывается в потоке сервера, когда новая конфигурация готова
+        std::function<void(const PreparedReload&)> on_prepared =
+            [&](const PreparedReload& reload) {
+                applyReload(reload, *current_config, *server, *logger);
+                current_config = reload.config;
+                reload_in_progress = false;
+            };
+
+        std::function<void(const boost::system::error_code&, int)>
+            on_reload = [&](const boost::system::error_code& ec, int) {
+                if (ec) {
+                    return;
+                }
 
-        signals.async_wait([&](const boost::system::error_code& ec,
-                               int signal_number) {
-            if (!ec) {
                 std::stringstream ss;
-                getCookedLogString(ss) << "Received signal " << signal_number
-                                       << ". Stopping server..." << std::endl;
+                if (reload_in_progress) {
+                    getCookedLogString(ss)
+                        << "Received SIGHUP. Previous reload is still in "
+                           "progress, ignored."
+                        << std::endl;
+                    std::cerr << ss.str();
+                    reload_signals.async_wait(on_reload);
+                    return;
+                }
+
+                getCookedLogString(ss)
+                    << "Received SIGHUP. Reloading configuration from "
+                    << config_filename << std::endl;
                 std::cout << ss.str();
 
-                // Останавливаем сервер
-                server->stop();
+                // Предыдущий поток уже отдал результат и завершается
+                if (reload_thread.joinable()) {
+                    reload_thread.join();
+                }
+
+                reload_in_progress = true;
+                reload_thread = std::thread(
+                    [reload_channel, config_filename, process_cpus,
+                     on_prepared, current = current_config]() {
+                        // Поток унаследовал привязку потока сервера.
+                        // Если вернуть исходный набор не удалось, работаем
+                        // на CPU сервера
+                        pinCurrentThread(process_cpus);
 
-                // Останавливаем io_context
-                io_context.stop();
+                        PreparedReload reload =
+                            prepareReload(current, config_filename);
 
-                // Останавливаем логгер
-                logger->stop();
+                        std::lock_guard<std::mutex> lock(
+                            reload_channel->mutex);
+                        if (reload_channel->io) {
+                            boost::asio::post(
+                                *reload_channel->io,
+                                [on_prepared, reload]() {
+                                    on_prepared(reload);
+                                });
+                        }
+                    });
+
+                reload_signals.async_wait(on_reload);
+            };
+        reload_signals.async_wait(on_reload);
+
+        signals.async_wait([&](const boost::system::error_code& ec,
+                               int signal_number) {
+            if (ec) {
+                return;
             }
+
+            std::stringstream ss;
+            getCookedLogString(ss)
+                << "Received signal " << signal_number << ". Draining "
+                << server->pendingQueries() << " pending queries (timeout "
+                << current_config->drain_timeout << " ms)..." << std::endl;
+            std::cout << ss.str();
+
+            reload_signals.cancel();
+
+            // Повторный сигнал во время drain останавливает сервер сразу
+            signals.async_wait(
+                [&](const boost::system::error_code& second_ec,
+                    int second_signal) {
+                    if (second_ec) {
+                        return;
+                    }
+
+                    std::stringstream ss;
+                    getCookedLogString(ss)
+                        << "Received signal " << second_signal
+                        << " while draining. Stopping immediately..."
+                        << std::endl;
+                    std::cout << ss.str();
+
+                    // Обработчик drain выводит итог и останавливает
+                    // io_context
+                    server->abortDrain();
+                });
+
+            server->drain(
+                std::chrono::milliseconds(current_config->drain_timeout),
+                [&](size_t drained, size_t abandoned) {
+                    std::stringstream ss;
+                    getCookedLogString(ss)
+                        << "Server stopped: " << drained
+                        << " queries drained, " << abandoned
+                        << " abandoned." << std::endl;
+                    std::cout << ss.str();
+
+                    signals.cancel();
+                    io_context.stop();
+                });
         });
 
         server->start();
@@ -69,6 +371,33 @@ int main(int argc, char** argv) {
 
         io_context.run();
 
+        // Незавершённое перечитывание конфигурации не задерживает остановку
+        abandonReload(*reload_channel, reload_thread);
+
+        // Дописываем оставшиеся в очереди сообщения не дольше
+        // log_flush_timeout и останавливаем логгер
+        size_t dropped_lines = 0;
+        bool flushed = logger->stop(
+            std::chrono::milliseconds(current_config->log_flush_timeout),
+            dropped_lines);
+
+        std::stringstream logger_stop_ss;
+        if (flushed) {
+            getCookedLogString(logger_stop_ss)
+                << "Logger stopped: log queue flushed." << std::endl;
+            std::cout << logger_stop_ss.str();
+        } else {
+            getCookedLogString(logger_stop_ss)
+                << "Log flush timed out after "
+                << current_config->log_flush_timeout << " ms: "
+                << dropped_lines << " log lines dropped." << std::endl;
+            std::cerr << logger_stop_ss.str();
+
+            // Рабочий поток логгера ещё может обращаться к объекту, поэтому
+            // не разрушаем его - поток завершится вместе с процессом
+            logger.release();
+        }
+
         std::stringstream final_ss;
         getCookedLogString(final_ss)
             << "Application shutdown complete." << std::endl;
@@ -78,7 +407,9 @@ int main(int argc, char** argv) {
         if (server) server->stop();
 
         // Останавливаем io_context
-        io_context.stop();
+        if (io_context_holder) io_context_holder->stop();
+
+        abandonReload(*reload_channel, reload_thread);
 
         // Останавливаем логгер
         if (logger) logger->stop();
@@ -110,6 +441,22 @@ void parseServerConfiguration(ServerConfiguration& p_conf,
         if (config["dns_server"]) {
             p_conf.base_dns_ip = config["dns_server"].as<std::string>();
         }
+        if (config["dns_server_port"]) {
+            p_conf.dns_server_port = config["dns_server_port"].as<uint16_t>();
+        }
+        if (config["drain_timeout"]) {
+            p_conf.drain_timeout = config["drain_timeout"].as<size_t>();
+        }
+        if (config["log_flush_timeout"]) {
+            p_conf.log_flush_timeout =
+                config["log_flush_timeout"].as<size_t>();
+        }
+        if (config["server_cpus"]) {
+            p_conf.server_cpus = config["server_cpus"].as<std::vector<int>>();
+        }
+        if (config["logger_cpus"]) {
+            p_conf.logger_cpus = config["logger_cpus"].as<std::vector<int>>();
+        }
     } catch (const YAML::Exception& e) {
         throw ConfigurateException("Error parsing YAML configuration: " +
                                    std::string(e.what()));
@@ -0,0 +1,243 @@
+#include "pcap_reader.h"
+
+#include <array>
+
+namespace {
+
+constexpr uint32_t PCAP_MAGIC_US = 0xa1b2c3d4;
+constexpr uint32_t PCAP_MAGIC_NS = 0xa1b23c4d;
+constexpr size_t PCAP_GLOBAL_HEADER_SIZE = 24;
+constexpr size_t PCAP_RECORD_HEADER_SIZE = 16;
+
+// Защита от повреждённых файлов: кадр больше этого размера не читается
+constexpr uint32_t MAX_FRAME_SIZE = 256 * 1024;
+
+constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+constexpr uint16_t ETHERTYPE_IPV6 = 0x86DD;
+constexpr uint16_t ETHERTYPE_VLAN = 0x8100;
+constexpr uint16_t ETHERTYPE_QINQ = 0x88A8;
+constexpr uint8_t IPPROTO_UDP_NUMBER = 17;
+
+uint16_t readNetwork16(const uint8_t* data) {
+    return (static_cast<uint16_t>(data[0]) << 8) |
+           static_cast<uint16_t>(data[1]);
+}
+
+uint32_t swap32(uint32_t value) {
+    return ((value & 0x000000FF) << 24) | ((value & 0x0000FF00) << 8) |
+           ((value & 0x00FF0000) >> 8) | ((value & 0xFF000000) >> 24);
+}
+
+uint32_t readLittle32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) |
+           (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) |
+           (static_cast<uint32_t>(data[3]) << 24);
+}
+
+}  // namespace
+
+PcapReader::PcapReader(const std::string& filename)
+    : file_(filename, std::ios::binary),
+      swapped_(false),
+      nanosecond_(false),
+      link_type_(0),
+      skipped_frames_(0) {
+    if (!file_.is_open()) {
+        throw PcapException("Failed to open capture file: " + filename);
+    }
+
+    std::array<uint8_t, PCAP_GLOBAL_HEADER_SIZE> header;
+    if (!file_.read(reinterpret_cast<char*>(header.data()), header.size())) {
+        throw PcapException("Capture file too short: " + filename);
+    }
+
+    // Порядок байт файла определяется по magic number
+    uint32_t magic = readLittle32(header.data());
+    if (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS) {
+        swapped_ = false;
+    } else if (swap32(magic) == PCAP_MAGIC_US ||
+               swap32(magic) == PCAP_MAGIC_NS) {
+        swapped_ = true;
+        magic = swap32(magic);
+    } else {
+        throw PcapException(
+            "Unsupported capture format (pcapng is not supported): " +
+            filename);
+    }
+    nanosecond_ = magic == PCAP_MAGIC_NS;
+
+    link_type_ = fileOrder32(header.data() + 20) & 0x0FFFFFFF;
+    switch (link_type_) {
+        case LINKTYPE_NULL:
+        case LINKTYPE_ETHERNET:
+        case LINKTYPE_RAW_BSD:
+        case LINKTYPE_RAW:
+        case LINKTYPE_LINUX_SLL:
+        case LINKTYPE_LINUX_SLL2:
+            break;
+        default:
+            throw PcapException("Unsupported link type " +
+                                std::to_string(link_type_) + ": " + filename);
+    }
+}
+
+uint32_t PcapReader::fileOrder32(const uint8_t* data) const {
+    uint32_t value = readLittle32(data);
+    return swapped_ ? swap32(value) : value;
+}
+
+std::vector<CapturedQuery> PcapReader::readQueries(uint16_t dns_port) {
+    std::vector<CapturedQuery> queries;
+    std::array<uint8_t, PCAP_RECORD_HEADER_SIZE> record;
+    std::vector<uint8_t> frame;
+
+    while (file_.read(reinterpret_cast<char*>(record.data()), record.size())) {
+        uint32_t ts_sec = fileOrder32(record.data());
+        uint32_t ts_frac = fileOrder32(record.data() + 4);
+        uint32_t captured_size = fileOrder32(record.data() + 8);
+
+        if (captured_size > MAX_FRAME_SIZE) {
+            throw PcapException("Corrupted capture: frame of " +
+                                std::to_string(captured_size) + " bytes");
+        }
+
+        frame.resize(captured_size);
+        if (!file_.read(reinterpret_cast<char*>(frame.data()), captured_size)) {
+            // Обрезанный последний кадр (захват прерван) пропускаем
+            ++skipped_frames_;
+            break;
+        }
+
+        size_t ip_offset = 0;
+        std::vector<uint8_t> payload;
+        if (!findIpPacket(frame.data(), frame.size(), ip_offset) ||
+            !extractUdpPayload(frame.data() + ip_offset,
+                               frame.size() - ip_offset, dns_port, payload)) {
+            ++skipped_frames_;
+            continue;
+        }
+
+        // Пропускаем ответы (QR = 1) и пакеты короче DNS-заголовка
+        if (payload.size() < DNS_HEADER_SIZE || (payload[2] & 0x80) != 0) {
+            ++skipped_frames_;
+            continue;
+        }
+
+        uint64_t timestamp_us = static_cast<uint64_t>(ts_sec) * 1000000 +
+                                (nanosecond_ ? ts_frac / 1000 : ts_frac);
+        queries.push_back({timestamp_us, std::move(payload)});
+    }
+
+    return queries;
+}
+
+bool PcapReader::findIpPacket(const uint8_t* frame, size_t size,
+                              size_t& ip_offset) const {
+    uint16_t ethertype = 0;
+
+    switch (link_type_) {
+        case LINKTYPE_NULL: {
+            // 4 байта семейства адресов в порядке байт записавшей машины
+            if (size < 4) {
+                return false;
+            }
+            uint32_t family = fileOrder32(frame);
+            ip_offset = 4;
+            // AF_INET везде 2, AF_INET6 зависит от ОС
+            if (family == 2) {
+                return true;
+            }
+            return family == 10 || family == 24 || family == 28 ||
+                   family == 30;
+        }
+        case LINKTYPE_RAW_BSD:
+        case LINKTYPE_RAW:
+            ip_offset = 0;
+            return size > 0;
+        case LINKTYPE_LINUX_SLL:
+            if (size < 16) {
+                return false;
+            }
+            ethertype = readNetwork16(frame + 14);
+            ip_offset = 16;
+            break;
+        case LINKTYPE_LINUX_SLL2:
+            if (size < 20) {
+                return false;
+            }
+            ethertype = readNetwork16(frame);
+            ip_offset = 20;
+            break;
+        case LINKTYPE_ETHERNET:
+            if (size < 14) {
+                return false;
+            }
+            ethertype = readNetwork16(frame + 12);
+            ip_offset = 14;
+
+            // Снимаем VLAN-теги (в том числе вложенные)
+            while (ethertype == ETHERTYPE_VLAN || ethertype == ETHERTYPE_QINQ) {
+                if (size < ip_offset + 4) {
+                    return false;
+                }
+                ethertype = readNetwork16(frame + ip_offset + 2);
+                ip_offset += 4;
+            }
+            break;
+        default:
+            return false;
+    }
+
+    return ethertype == ETHERTYPE_IPV4 || ethertype == ETHERTYPE_IPV6;
+}
+
+bool PcapReader::extractUdpPayload(const uint8_t* packet, size_t size,
+                                   uint16_t dns_port,
+                                   std::vector<uint8_t>& payload) const {
+    if (size < 1) {
+        return false;
+    }
+
+    size_t udp_offset = 0;
+    uint8_t version = packet[0] >> 4;
+
+    if (version == 4) {
+        if (size < 20) {
+            return false;
+        }
+        size_t header_size = (packet[0] & 0x0F) * 4;
+        uint16_t fragment = readNetwork16(packet + 6);
+
+        // Фрагментированные датаграммы не собираем
+        if (header_size < 20 || (fragment & 0x3FFF) != 0 ||
+            packet[9] != IPPROTO_UDP_NUMBER) {
+            return false;
+        }
+        udp_offset = header_size;
+    } else if (version == 6) {
+        // Заголовки расширений IPv6 не поддерживаются
+        if (size < 40 || packet[6] != IPPROTO_UDP_NUMBER) {
+            return false;
+        }
+        udp_offset = 40;
+    } else {
+        return false;
+    }
+
+    if (size < udp_offset + 8) {
+        return false;
+    }
+
+    const uint8_t* udp = packet + udp_offset;
+    uint16_t destination_port = readNetwork16(udp + 2);
+    uint16_t udp_length = readNetwork16(udp + 4);
+
+    if (destination_port != dns_port || udp_length < 8 ||
+        udp_offset + udp_length > size) {
+        return false;
+    }
+
+    payload.assign(udp + 8, udp + udp_length);
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef PCAP_READER_H
+#define PCAP_READER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class PcapException : public std::exception {
+   public:
+    explicit PcapException(const std::string& message) : message_(message) {}
+    explicit PcapException(const char* message) : message_(message) {}
+
+    virtual const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+   private:
+    std::string message_;
+};
+
+// DNS-запрос, извлечённый из захвата
+struct CapturedQuery {
+    uint64_t timestamp_us;  // Время захвата в микросекундах
+    std::vector<uint8_t> payload;
+};
+
+// Читает файл в классическом формате pcap (без libpcap) и извлекает
+// UDP-датаграммы, отправленные на заданный порт
+class PcapReader {
+   public:
+    explicit PcapReader(const std::string& filename);
+
+    // Возвращает DNS-запросы (QR = 0) в порядке захвата
+    std::vector<CapturedQuery> readQueries(uint16_t dns_port = 53);
+
+    // Кадры, которые не удалось разобрать или которые не являются запросами
+    size_t skippedFrames() const { return skipped_frames_; }
+
+   private:
+    // Типы канального уровня (LINKTYPE_*)
+    static constexpr uint32_t LINKTYPE_NULL = 0;
+    static constexpr uint32_t LINKTYPE_ETHERNET = 1;
+    static constexpr uint32_t LINKTYPE_RAW_BSD = 12;
+    static constexpr uint32_t LINKTYPE_RAW = 101;
+    static constexpr uint32_t LINKTYPE_LINUX_SLL = 113;
+    static constexpr uint32_t LINKTYPE_LINUX_SLL2 = 276;
+
+    static constexpr size_t DNS_HEADER_SIZE = 12;
+
+    std::ifstream file_;
+    bool swapped_;
+    bool nanosecond_;
+    uint32_t link_type_;
+    size_t skipped_frames_;
+
+    uint32_t fileOrder32(const uint8_t* data) const;
+
+    // Находит начало IP-пакета в кадре. Возвращает false для кадров не IP
+    bool findIpPacket(const uint8_t* frame, size_t size,
+                      size_t& ip_offset) const;
+
+    bool extractUdpPayload(const uint8_t* packet, size_t size,
+                           uint16_t dns_port,
+                           std::vector<uint8_t>& payload) const;
+};
+
+#endif  // PCAP_READER_H
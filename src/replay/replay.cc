@@ -0,0 +1,539 @@
+#include <algorithm>
+#include <array>
+#include <boost/asio.hpp>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "pcap_reader.h"
+
+using boost::asio::ip::udp;
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t MAX_RESPONSE_SIZE = 4096;
+constexpr size_t DNS_HEADER_SIZE = 12;
+
+// Период проверки запросов на таймаут
+constexpr auto SWEEP_INTERVAL = std::chrono::milliseconds(50);
+
+// Сколько запросов отправляется подряд, прежде чем io_context получит
+// возможность обработать ответы
+constexpr size_t SEND_BATCH_SIZE = 256;
+
+// Верхняя граница запросов в полёте: каждому нужен свободный 16-битный ID
+constexpr size_t MAX_INFLIGHT_LIMIT = 65535;
+constexpr size_t DEFAULT_MAX_INFLIGHT = 60000;
+
+// Запрашиваемый размер буфера приёма: при большом числе запросов в полёте
+// ответы приходят пачками (ядро может ограничить значение rmem_max)
+constexpr int RECEIVE_BUFFER_SIZE = 8 * 1024 * 1024;
+
+// Воспроизводит запросы из захвата против DNS-сервера и сверяет ответы
+class Replayer {
+   public:
+    Replayer(boost::asio::io_context& io_context, const udp::endpoint& target,
+             std::vector<CapturedQuery> queries, double speed,
+             std::chrono::milliseconds timeout, size_t max_inflight)
+        : socket_(io_context, udp::endpoint(target.protocol(), 0)),
+          send_timer_(io_context),
+          sweep_timer_(io_context),
+          target_(target),
+          queries_(std::move(queries)),
+          speed_(speed),
+          timeout_(timeout),
+          max_inflight_(max_inflight) {
+        boost::system::error_code ec;
+        socket_.set_option(
+            boost::asio::socket_base::receive_buffer_size(RECEIVE_BUFFER_SIZE),
+            ec);
+
+        // ID выдаются по кругу: освободившийся ID используется последним,
+        // чтобы опоздавший ответ не совпал с новым запросом
+        for (uint32_t id = 0; id <= UINT16_MAX; ++id) {
+            free_ids_.push_back(static_cast<uint16_t>(id));
+        }
+        timed_out_ids_.assign(UINT16_MAX + 1, false);
+
+        // Расписание отправки строится от первого по времени запроса
+        std::stable_sort(queries_.begin(), queries_.end(),
+                         [](const CapturedQuery& lhs, const CapturedQuery& rhs) {
+                             return lhs.timestamp_us < rhs.timestamp_us;
+                         });
+    }
+
+    void start() {
+        started_at_ = Clock::now();
+        receive();
+        sweep();
+        sendDue();
+    }
+
+    void printReport(std::ostream& os) const;
+
+   private:
+    struct PendingQuery {
+        Clock::time_point sent_at;
+        std::vector<uint8_t> question;
+    };
+
+    udp::socket socket_;
+    boost::asio::steady_timer send_timer_;
+    boost::asio::steady_timer sweep_timer_;
+    udp::endpoint target_;
+    udp::endpoint sender_endpoint_;
+    std::array<uint8_t, MAX_RESPONSE_SIZE> response_;
+
+    std::vector<CapturedQuery> queries_;
+    double speed_;  // 0 - без соблюдения исходных интервалов
+    std::chrono::milliseconds timeout_;
+    size_t max_inflight_;
+    size_t next_query_{0};
+    // Отправка приостановлена, пока не освободится место для запроса
+    bool waiting_for_capacity_{false};
+
+    // Запросы в полёте по ID, под которым они отправлены
+    std::unordered_map<uint16_t, PendingQuery> pending_;
+    std::deque<uint16_t> free_ids_;
+    // ID, запрос под которыми истёк и ещё не отправлен заново: ответ с таким
+    // ID считается опоздавшим, а не чужим
+    std::vector<bool> timed_out_ids_;
+
+    Clock::time_point started_at_;
+    Clock::time_point last_sent_at_;
+    Clock::time_point finished_at_;
+    std::vector<double> latencies_us_;
+    size_t sent_{0};
+    size_t send_errors_{0};
+    size_t id_mismatches_{0};
+    size_t late_responses_{0};
+    size_t question_mismatches_{0};
+    size_t timeouts_{0};
+    size_t unexpected_{0};
+    bool finished_{false};
+
+    Clock::time_point dueTime(const CapturedQuery& query) const {
+        if (speed_ <= 0) {
+            return started_at_;
+        }
+        double offset_us =
+            (query.timestamp_us - queries_.front().timestamp_us) / speed_;
+        return started_at_ +
+               std::chrono::microseconds(static_cast<int64_t>(offset_us));
+    }
+
+    // Секция вопроса (имя + QTYPE + QCLASS) или пустой вектор
+    static std::vector<uint8_t> extractQuestion(const uint8_t* data,
+                                                size_t size);
+    static bool sameQuestion(const std::vector<uint8_t>& lhs,
+                             const std::vector<uint8_t>& rhs);
+
+    bool allocateId(uint16_t& id);
+    void releaseId(std::unordered_map<uint16_t, PendingQuery>::iterator& it);
+
+    void sendDue();
+    void postSendDue();
+    void resumeSending();
+    void sendQuery(CapturedQuery& query);
+    void receive();
+    void handleResponse(size_t bytes_recvd);
+    void sweep();
+    void finishIfDone();
+};
+
+std::vector<uint8_t> Replayer::extractQuestion(const uint8_t* data,
+                                               size_t size) {
+    if (size < DNS_HEADER_SIZE) {
+        return {};
+    }
+    uint16_t qdcount = (static_cast<uint16_t>(data[4]) << 8) | data[5];
+    if (qdcount == 0) {
+        return {};
+    }
+
+    size_t pos = DNS_HEADER_SIZE;
+    while (pos < size && data[pos] != 0) {
+        // В вопросе запроса сжатие не ожидается, указатель завершает имя
+        if ((data[pos] & 0xC0) == 0xC0) {
+            pos += 1;
+            break;
+        }
+        pos += data[pos] + 1;
+    }
+    pos += 1 + 4;  // Завершающий ноль, QTYPE и QCLASS
+
+    if (pos > size) {
+        return {};
+    }
+    return std::vector<uint8_t>(data + DNS_HEADER_SIZE, data + pos);
+}
+
+bool Replayer::sameQuestion(const std::vector<uint8_t>& lhs,
+                            const std::vector<uint8_t>& rhs) {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+
+    // Регистр имени может меняться (DNS 0x20), поэтому символы меток
+    // сравниваем без учёта регистра. Длины меток, QTYPE и QCLASS - точно
+    size_t pos = 0;
+    while (pos < lhs.size() && lhs[pos] != 0 &&
+           (lhs[pos] & 0xC0) != 0xC0) {
+        size_t label_end = pos + 1 + lhs[pos];
+        if (lhs[pos] != rhs[pos] || label_end > lhs.size()) {
+            return false;
+        }
+        for (++pos; pos < label_end; ++pos) {
+            if (std::tolower(lhs[pos]) != std::tolower(rhs[pos])) {
+                return false;
+            }
+        }
+    }
+
+    return std::equal(lhs.begin() + pos, lhs.end(), rhs.begin() + pos);
+}
+
+bool Replayer::allocateId(uint16_t& id) {
+    // Число запросов в полёте ограничено max_inflight_ < 65536, поэтому
+    // свободный ID всегда есть
+    if (free_ids_.empty()) {
+        return false;
+    }
+    id = free_ids_.front();
+    free_ids_.pop_front();
+    return true;
+}
+
+void Replayer::releaseId(
+    std::unordered_map<uint16_t, PendingQuery>::iterator& it) {
+    free_ids_.push_back(it->first);
+    it = pending_.erase(it);
+}
+
+void Replayer::sendDue() {
+    auto now = Clock::now();
+    size_t batch = 0;
+    while (next_query_ < queries_.size() &&
+           dueTime(queries_[next_query_]) <= now) {
+        if (pending_.size() >= max_inflight_) {
+            // Продолжим, когда ответ или таймаут освободит место
+            waiting_for_capacity_ = true;
+            return;
+        }
+        if (batch == SEND_BATCH_SIZE) {
+            // Даём io_context прочитать накопившиеся ответы
+            postSendDue();
+            return;
+        }
+
+        sendQuery(queries_[next_query_]);
+        ++next_query_;
+        ++batch;
+    }
+
+    if (next_query_ < queries_.size()) {
+        send_timer_.expires_at(dueTime(queries_[next_query_]));
+        send_timer_.async_wait([this](boost::system::error_code ec) {
+            if (!ec) {
+                sendDue();
+            }
+        });
+    } else {
+        finishIfDone();
+    }
+}
+
+void Replayer::postSendDue() {
+    boost::asio::post(socket_.get_executor(), [this]() {
+        if (!finished_) {
+            sendDue();
+        }
+    });
+}
+
+void Replayer::resumeSending() {
+    if (waiting_for_capacity_ && pending_.size() < max_inflight_) {
+        waiting_for_capacity_ = false;
+        postSendDue();
+    }
+}
+
+void Replayer::sendQuery(CapturedQuery& query) {
+    std::vector<uint8_t>& payload = query.payload;
+    uint16_t id = 0;
+
+    if (!allocateId(id)) {
+        ++send_errors_;
+        return;
+    }
+    timed_out_ids_[id] = false;
+    payload[0] = static_cast<uint8_t>(id >> 8);
+    payload[1] = static_cast<uint8_t>(id & 0xFF);
+
+    boost::system::error_code ec;
+    socket_.send_to(boost::asio::buffer(payload), target_, 0, ec);
+    if (ec) {
+        free_ids_.push_back(id);
+        ++send_errors_;
+        return;
+    }
+
+    last_sent_at_ = Clock::now();
+    pending_[id] = {last_sent_at_,
+                    extractQuestion(payload.data(), payload.size())};
+    ++sent_;
+}
+
+void Replayer::receive() {
+    socket_.async_receive_from(
+        boost::asio::buffer(response_), sender_endpoint_,
+        [this](boost::system::error_code ec, std::size_t bytes_recvd) {
+            if (ec == boost::asio::error::operation_aborted) {
+                return;
+            }
+            if (!ec) {
+                handleResponse(bytes_recvd);
+            }
+
+            // Вычитываем все уже пришедшие ответы, иначе между пачками
+            // отправки успевал бы обработаться только один
+            while (!finished_ && socket_.available(ec) > 0 && !ec) {
+                bytes_recvd = socket_.receive_from(
+                    boost::asio::buffer(response_), sender_endpoint_, 0, ec);
+                if (ec) {
+                    break;
+                }
+                handleResponse(bytes_recvd);
+            }
+
+            if (!finished_) {
+                receive();
+            }
+        });
+}
+
+void Replayer::handleResponse(size_t bytes_recvd) {
+    auto received_at = Clock::now();
+
+    if (bytes_recvd < DNS_HEADER_SIZE) {
+        ++unexpected_;
+        return;
+    }
+
+    uint16_t id = (static_cast<uint16_t>(response_[0]) << 8) | response_[1];
+    auto it = pending_.find(id);
+    if (it == pending_.end()) {
+        if (timed_out_ids_[id]) {
+            ++late_responses_;
+        } else {
+            // ID, под которым сейчас ничего не отправлено
+            ++id_mismatches_;
+        }
+        return;
+    }
+
+    if (!sameQuestion(it->second.question,
+                      extractQuestion(response_.data(), bytes_recvd))) {
+        ++question_mismatches_;
+    } else {
+        latencies_us_.push_back(
+            std::chrono::duration<double, std::micro>(received_at -
+                                                      it->second.sent_at)
+                .count());
+    }
+
+    releaseId(it);
+    resumeSending();
+    finishIfDone();
+}
+
+void Replayer::sweep() {
+    auto now = Clock::now();
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (now - it->second.sent_at >= timeout_) {
+            ++timeouts_;
+            timed_out_ids_[it->first] = true;
+            releaseId(it);
+        } else {
+            ++it;
+        }
+    }
+
+    resumeSending();
+    finishIfDone();
+    if (finished_) {
+        return;
+    }
+
+    sweep_timer_.expires_after(SWEEP_INTERVAL);
+    sweep_timer_.async_wait([this](boost::system::error_code ec) {
+        if (!ec) {
+            sweep();
+        }
+    });
+}
+
+void Replayer::finishIfDone() {
+    if (finished_ || next_query_ < queries_.size() || !pending_.empty()) {
+        return;
+    }
+
+    finished_ = true;
+    finished_at_ = Clock::now();
+
+    boost::system::error_code ec;
+    send_timer_.cancel();
+    sweep_timer_.cancel();
+    socket_.cancel(ec);
+    socket_.close(ec);
+}
+
+void Replayer::printReport(std::ostream& os) const {
+    using Seconds = std::chrono::duration<double>;
+    double send_seconds = Seconds(last_sent_at_ - started_at_).count();
+    double total_seconds = Seconds(finished_at_ - started_at_).count();
+
+    os << std::fixed << std::setprecision(1);
+    os << "Queries sent:        " << sent_ << '\n';
+    os << "Answered:            " << latencies_us_.size() << '\n';
+    os << "Timeouts:            " << timeouts_ << '\n';
+    os << "Question mismatches: " << question_mismatches_ << '\n';
+    os << "Late responses:      " << late_responses_ << '\n';
+    os << "ID mismatches:       " << id_mismatches_ << '\n';
+    os << "Malformed responses: " << unexpected_ << '\n';
+    os << "Send errors:         " << send_errors_ << '\n';
+
+    os << "Duration:            " << total_seconds << " s\n";
+    if (send_seconds > 0) {
+        os << "Offered QPS:         " << sent_ / send_seconds << '\n';
+    }
+    if (total_seconds > 0) {
+        os << "Answered QPS:        " << latencies_us_.size() / total_seconds
+           << '\n';
+    }
+
+    if (latencies_us_.empty()) {
+        return;
+    }
+
+    std::vector<double> sorted = latencies_us_;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](double p) {
+        size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+        return sorted[std::max<size_t>(rank, 1) - 1];
+    };
+
+    os << "Latency (us):        min " << sorted.front() << ", p50 "
+       << percentile(0.50) << ", p90 " << percentile(0.90) << ", p99 "
+       << percentile(0.99) << ", p99.9 " << percentile(0.999) << ", max "
+       << sorted.back() << '\n';
+}
+
+// Простейший форвард-сервер для проверки на loopback: отвечает на каждый
+// запрос его же копией с выставленными флагами QR и RA
+static void runMockUpstream(uint16_t port) {
+    boost::asio::io_context io_context;
+    udp::socket socket(io_context,
+                       udp::endpoint(boost::asio::ip::address_v4::loopback(),
+                                     port));
+    socket.set_option(
+        boost::asio::socket_base::receive_buffer_size(RECEIVE_BUFFER_SIZE));
+    std::array<uint8_t, MAX_RESPONSE_SIZE> buffer;
+    udp::endpoint sender;
+
+    std::cout << "Mock upstream listening on 127.0.0.1:" << port << std::endl;
+
+    while (true) {
+        size_t size = socket.receive_from(boost::asio::buffer(buffer), sender);
+        if (size < DNS_HEADER_SIZE) {
+            continue;
+        }
+        buffer[2] |= 0x80;
+        buffer[3] = 0x80;
+
+        boost::system::error_code ec;
+        socket.send_to(boost::asio::buffer(buffer, size), sender, 0, ec);
+    }
+}
+
+static void printUsage() {
+    std::cerr << "Usage: DNSReplay <capture.pcap> <server_ip> <server_port> "
+                 "[--speed N] [--timeout MS] [--max-inflight N]\n"
+                 "       DNSReplay --mock-upstream <port>\n"
+                 "  --speed N     replay N times faster than captured "
+                 "(default 1, 0 - as fast as possible)\n"
+                 "  --timeout MS  per-query response timeout (default 2000)\n"
+                 "  --max-inflight N  queries awaiting response before "
+                 "sending pauses (default 60000, at most 65535)"
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    try {
+        if (argc == 3 && std::string(argv[1]) == "--mock-upstream") {
+            runMockUpstream(static_cast<uint16_t>(std::stoul(argv[2])));
+            return 0;
+        }
+
+        if (argc < 4) {
+            printUsage();
+            return 1;
+        }
+
+        double speed = 1.0;
+        std::chrono::milliseconds timeout(2000);
+        size_t max_inflight = DEFAULT_MAX_INFLIGHT;
+        for (int i = 4; i < argc; ++i) {
+            std::string option = argv[i];
+            if (option == "--speed" && i + 1 < argc) {
+                speed = std::stod(argv[++i]);
+                if (!(speed >= 0)) {
+                    printUsage();
+                    return 1;
+                }
+            } else if (option == "--timeout" && i + 1 < argc) {
+                timeout = std::chrono::milliseconds(std::stoul(argv[++i]));
+            } else if (option == "--max-inflight" && i + 1 < argc) {
+                max_inflight = std::stoul(argv[++i]);
+                if (max_inflight == 0 || max_inflight > MAX_INFLIGHT_LIMIT) {
+                    printUsage();
+                    return 1;
+                }
+            } else {
+                printUsage();
+                return 1;
+            }
+        }
+
+        PcapReader reader(argv[1]);
+        std::vector<CapturedQuery> queries = reader.readQueries();
+
+        std::cout << "Loaded " << queries.size() << " queries from "
+                  << argv[1] << " (" << reader.skippedFrames()
+                  << " frames skipped)" << std::endl;
+        if (queries.empty()) {
+            return 1;
+        }
+
+        boost::asio::io_context io_context;
+        udp::endpoint target(boost::asio::ip::make_address(argv[2]),
+                             static_cast<uint16_t>(std::stoul(argv[3])));
+
+        Replayer replayer(io_context, target, std::move(queries), speed,
+                          timeout, max_inflight);
+        replayer.start();
+        io_context.run();
+
+        replayer.printReport(std::cout);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -6,8 +6,24 @@
 #include "../utils.h"
 
 void DNSServer::handleRequest(std::size_t bytes_recvd) {
-    auto context = std::make_shared<QueryContext>(data_.data(), bytes_recvd,
-                                                  sender_endpoint_);
+    // Пакеты короче DNS-заголовка не пересылаем
+    if (bytes_recvd < DNS_HEADER_SIZE) {
+        return;
+    }
+
+    auto context = std::make_shared<QueryContext>(
+        data_.data(), bytes_recvd, sender_endpoint_,
+        std::atomic_load(&forward_endpoint_));
+
+    if (!allocateUpstreamId(context->upstream_id)) {
+        std::stringstream ss;
+        getCookedLogString(ss) << "Error: too many queries in flight, "
+                               << "dropping query from "
+                               << sender_endpoint_.address().to_string()
+                               << std::endl;
+        std::cerr << ss.str();
+        return;
+    }
 
     try {
         std::string domain_name =
@@ -16,59 +32,199 @@ void DNSServer::handleRequest(std::size_t bytes_recvd) {
             sender_endpoint_.address().to_string() + " " + domain_name;
 
         logger_ << log_message;
-    } catch (const LoggerException& e) {
+    } catch (const std::exception& e) {
         std::stringstream ss;
         getCookedLogString(ss) << "Error: " << e.what() << std::endl;
 
         std::cerr << ss.str();  // На будущее - написать систему логгирования
     }
 
+    context->buffer[0] = static_cast<uint8_t>(context->upstream_id >> 8);
+    context->buffer[1] = static_cast<uint8_t>(context->upstream_id & 0xFF);
+
+    upstream_queries_[context->upstream_id] = context;
+    ++pending_queries_;
+
     forward_socket_.async_send_to(
-        boost::asio::buffer(context->buffer), forward_endpoint_,
+        boost::asio::buffer(context->buffer), *context->forward_endpoint,
         [this, context](boost::system::error_code ec, std::size_t) {
-            if (!ec) {
-                startReceiveResponse(context);
+            if (ec && releaseUpstreamQuery(context)) {
+                finishQuery(false);
             }
         });
 }
 
-void DNSServer::startReceiveResponse(std::shared_ptr<QueryContext> context) {
-    auto response_buffer =
-        std::make_shared<std::array<uint8_t, MAX_DNS_PACKET_SIZE>>();
+bool DNSServer::allocateUpstreamId(uint16_t& id) {
+    if (free_upstream_ids_.empty()) {
+        return false;
+    }
+    id = free_upstream_ids_.front();
+    free_upstream_ids_.pop_front();
+    return true;
+}
+
+std::unordered_map<uint16_t,
+                   std::shared_ptr<DNSServer::QueryContext>>::iterator
+DNSServer::eraseUpstreamQuery(
+    std::unordered_map<uint16_t, std::shared_ptr<QueryContext>>::iterator
+        it) {
+    free_upstream_ids_.push_back(it->first);
+    return upstream_queries_.erase(it);
+}
 
+bool DNSServer::releaseUpstreamQuery(
+    const std::shared_ptr<QueryContext>& context) {
+    auto it = upstream_queries_.find(context->upstream_id);
+    if (it == upstream_queries_.end() || it->second != context) {
+        return false;
+    }
+
+    eraseUpstreamQuery(it);
+    return true;
+}
+
+std::shared_ptr<const udp::endpoint> DNSServer::resolveForwardAddress(
+    const std::string& forward_address, const uint16_t forward_port) {
+    boost::asio::io_context io_context;
+    udp::resolver resolver(io_context);
+
+    auto endpoints = resolver.resolve(udp::v4(), forward_address,
+                                      std::to_string(forward_port));
+    return std::make_shared<const udp::endpoint>(*endpoints.begin());
+}
+
+void DNSServer::receiveUpstream() {
     forward_socket_.async_receive_from(
-        boost::asio::buffer(*response_buffer), forward_endpoint_,
-        [this, context, response_buffer](boost::system::error_code ec,
-                                         std::size_t bytes_transferred) {
+        boost::asio::buffer(upstream_data_), upstream_sender_,
+        [this](boost::system::error_code ec, std::size_t bytes_transferred) {
+            if (ec == boost::asio::error::operation_aborted) {
+                return;
+            }
             if (!ec) {
-                handleResponse(context, response_buffer, bytes_transferred);
+                handleResponse(bytes_transferred);
+            }
+            if (forward_socket_.is_open()) {
+                receiveUpstream();
             }
         });
 }
 
-void DNSServer::handleResponse(
-    std::shared_ptr<QueryContext> context,
-    std::shared_ptr<std::array<uint8_t, MAX_DNS_PACKET_SIZE>> response_buffer,
-    std::size_t bytes_transferred) {
-    // Проверяем ID ответа
-    if (bytes_transferred >= 2) {
-        uint16_t response_id =
-            (static_cast<uint16_t>((*response_buffer)[0]) << 8) |
-            static_cast<uint16_t>((*response_buffer)[1]);
-
-        if (response_id == context->query_id) {
-            // Отправляем ответ клиенту через основной сокет
-            socket_.async_send_to(
-                boost::asio::buffer(*response_buffer, bytes_transferred),
-                context->client_endpoint,
-                [](boost::system::error_code ec, std::size_t) {
-                    if (ec) {
-                        std::cerr << "Error sending response to client: "
-                                  << ec.message() << std::endl;
-                    }
-                });
+void DNSServer::handleResponse(std::size_t bytes_transferred) {
+    if (bytes_transferred < DNS_HEADER_SIZE) {
+        return;
+    }
+
+    // Ответы с неизвестным ID (опоздавшие после таймаута или чужие)
+    // отбрасываются, ни одному запросу они не принадлежат
+    uint16_t response_id = (static_cast<uint16_t>(upstream_data_[0]) << 8) |
+                           static_cast<uint16_t>(upstream_data_[1]);
+    auto it = upstream_queries_.find(response_id);
+    if (it == upstream_queries_.end()) {
+        return;
+    }
+
+    // Ответ принимается только от сервера, которому был отправлен запрос
+    std::shared_ptr<QueryContext> context = it->second;
+    if (upstream_sender_ != *context->forward_endpoint) {
+        return;
+    }
+    eraseUpstreamQuery(it);
+
+    // Возвращаем клиенту его исходный ID
+    context->buffer.assign(upstream_data_.begin(),
+                           upstream_data_.begin() + bytes_transferred);
+    context->buffer[0] = static_cast<uint8_t>(context->query_id >> 8);
+    context->buffer[1] = static_cast<uint8_t>(context->query_id & 0xFF);
+
+    // Отправляем ответ клиенту через основной сокет
+    socket_.async_send_to(
+        boost::asio::buffer(context->buffer), context->client_endpoint,
+        [this, context](boost::system::error_code ec, std::size_t) {
+            if (ec) {
+                std::cerr << "Error sending response to client: "
+                          << ec.message() << std::endl;
+            }
+            finishQuery(!ec);
+        });
+}
+
+void DNSServer::sweepUpstream() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = upstream_queries_.begin(); it != upstream_queries_.end();) {
+        if (now - it->second->sent_at >= UPSTREAM_TIMEOUT) {
+            it = eraseUpstreamQuery(it);
+            finishQuery(false);
+        } else {
+            ++it;
+        }
+    }
+
+    // После остановки сервера (в том числе из finishQuery) таймер не взводим
+    if (!forward_socket_.is_open()) {
+        return;
+    }
+
+    upstream_timer_.expires_after(UPSTREAM_SWEEP_INTERVAL);
+    upstream_timer_.async_wait([this](boost::system::error_code ec) {
+        if (!ec) {
+            sweepUpstream();
+        }
+    });
+}
+
+void DNSServer::finishQuery(bool answered) {
+    if (pending_queries_ > 0) {
+        --pending_queries_;
+    }
+
+    if (!draining_) {
+        return;
+    }
+
+    if (answered) {
+        ++drain_answered_;
+    } else {
+        ++drain_failed_;
+    }
+
+    if (pending_queries_ == 0) {
+        completeDrain();
+    }
+}
+
+void DNSServer::drain(std::chrono::milliseconds timeout, DrainHandler handler) {
+    draining_ = true;
+    drain_answered_ = 0;
+    drain_failed_ = 0;
+    drain_handler_ = std::move(handler);
+
+    if (pending_queries_ == 0) {
+        completeDrain();
+        return;
+    }
+
+    drain_timer_.expires_after(timeout);
+    drain_timer_.async_wait([this](boost::system::error_code ec) {
+        if (!ec) {
+            completeDrain();
         }
+    });
+}
+
+void DNSServer::completeDrain() {
+    // Обработчик вызывается один раз: по таймеру или по последнему запросу
+    if (!drain_handler_) {
+        return;
     }
+    DrainHandler handler = std::move(drain_handler_);
+    drain_handler_ = nullptr;
+
+    // Не дождавшиеся ответа к концу drain считаются брошенными вместе с
+    // завершившимися ошибкой во время ожидания
+    size_t abandoned = drain_failed_ + pending_queries_;
+    stop();
+
+    handler(drain_answered_, abandoned);
 }
 
 std::string DNSServer::DNSNameExtractor::extractDomainName(
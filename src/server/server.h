@@ -2,74 +2,153 @@
 #define SERVER_H
 
 #include <boost/asio.hpp>
+#include <chrono>
 #include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
 
 #include "../logger/logger.h"
 
 using boost::asio::ip::udp;
 
 constexpr size_t MAX_DNS_PACKET_SIZE = 512;  // Максимальный размер DNS пакета
+constexpr size_t DNS_HEADER_SIZE = 12;
+
+// Сколько ждать ответа форвард-сервера, прежде чем считать запрос потерянным
+constexpr auto UPSTREAM_TIMEOUT = std::chrono::milliseconds(2000);
+constexpr auto UPSTREAM_SWEEP_INTERVAL = std::chrono::milliseconds(100);
 
 class DNSServer {
    public:
     DNSServer(const uint16_t dns_port, boost::asio::io_context& io_context,
-              const std::string& forward_address, Logger& logger)
+              const std::string& forward_address, const uint16_t forward_port,
+              Logger& logger)
         : socket_(io_context, udp::endpoint(udp::v4(), dns_port)),
           forward_socket_(io_context),
-          resolver_(io_context),
-          forward_address_(forward_address),
+          upstream_timer_(io_context),
+          drain_timer_(io_context),
           logger_(logger) {
         // Резолвим адрес форвард-сервера
-        auto endpoints = resolver_.resolve(udp::v4(), forward_address_, "53");
-        forward_endpoint_ = *endpoints.begin();
+        setForwardEndpoint(
+            resolveForwardAddress(forward_address, forward_port));
 
         // Открываем сокет для пересылки
         forward_socket_.open(udp::v4());
+
+        // Освободившийся ID уходит в конец очереди и переиспользуется
+        // последним, чтобы опоздавший ответ не совпал с новым запросом
+        for (uint32_t id = 0; id <= UINT16_MAX; ++id) {
+            free_upstream_ids_.push_back(static_cast<uint16_t>(id));
+        }
     }
 
-    void start() { receive(); }
+    void start() {
+        receive();
+        receiveUpstream();
+        sweepUpstream();
+    }
+
+    // Синхронно резолвит адрес форвард-сервера. Не использует io_context
+    // сервера, поэтому может вызываться из любого потока
+    static std::shared_ptr<const udp::endpoint> resolveForwardAddress(
+        const std::string& forward_address, const uint16_t forward_port);
+
+    // Атомарно публикует новый адрес форвард-сервера.
+    // Уже отправленные запросы дорабатывают со старым адресом
+    void setForwardEndpoint(std::shared_ptr<const udp::endpoint> endpoint) {
+        std::atomic_store(&forward_endpoint_, std::move(endpoint));
+    }
 
     void stop() {
         // Отменяем все асинхронные операции
         boost::system::error_code ec;
         socket_.cancel(ec);
+        forward_socket_.cancel(ec);
+        upstream_timer_.cancel();
+        drain_timer_.cancel();
 
-        // Закрываем сокет
+        // Закрываем сокеты
         socket_.close(ec);
+        forward_socket_.close(ec);
     }
 
+    // Обработчик завершения drain: число запросов, на которые клиент получил
+    // ответ, и запросов, оставшихся без ответа (таймаут форвард-сервера,
+    // ошибка отправки или незавершённые к концу ожидания)
+    using DrainHandler = std::function<void(size_t drained, size_t abandoned)>;
+
+    // Плавная остановка: новые пакеты больше не обрабатываются, уже принятые
+    // запросы дожидаются ответа не дольше timeout, после чего сервер
+    // останавливается и вызывается handler
+    void drain(std::chrono::milliseconds timeout, DrainHandler handler);
+
+    // Досрочно завершает drain: сервер останавливается сразу, handler
+    // вызывается с текущими счётчиками, незавершённые запросы считаются
+    // брошенными
+    void abortDrain() { completeDrain(); }
+
+    size_t pendingQueries() const { return pending_queries_; }
+
    private:
     struct QueryContext {
         std::vector<uint8_t> buffer;
         udp::endpoint client_endpoint;
-        uint16_t query_id;
+        std::shared_ptr<const udp::endpoint> forward_endpoint;
+        uint16_t query_id;     // ID клиента
+        uint16_t upstream_id;  // ID, под которым запрос ушёл форвард-серверу
+        std::chrono::steady_clock::time_point sent_at;
 
         QueryContext(const uint8_t* data, size_t size,
-                     const udp::endpoint& endpoint)
-            : buffer(data, data + size), client_endpoint(endpoint) {
+                     const udp::endpoint& endpoint,
+                     std::shared_ptr<const udp::endpoint> forward)
+            : buffer(data, data + size),
+              client_endpoint(endpoint),
+              forward_endpoint(std::move(forward)),
+              sent_at(std::chrono::steady_clock::now()) {
             // Извлекаем ID запроса из DNS-заголовка (первые 2 байта)
-            if (size >= 2) {
-                query_id = (static_cast<uint16_t>(data[0]) << 8) |
-                           static_cast<uint16_t>(data[1]);
-            }
+            query_id = (static_cast<uint16_t>(data[0]) << 8) |
+                       static_cast<uint16_t>(data[1]);
+            upstream_id = 0;  // Назначается в allocateUpstreamId
         }
     };
 
     udp::socket socket_;
     udp::socket forward_socket_;
-    udp::resolver resolver_;
-    udp::endpoint forward_endpoint_;
+    // Текущий снимок адреса форвард-сервера, читается и заменяется только
+    // через std::atomic_load/std::atomic_store
+    std::shared_ptr<const udp::endpoint> forward_endpoint_;
     udp::endpoint sender_endpoint_;
-    std::string forward_address_;
     std::array<uint8_t, MAX_DNS_PACKET_SIZE> data_;
+    udp::endpoint upstream_sender_;
+    std::array<uint8_t, MAX_DNS_PACKET_SIZE> upstream_data_;
+    boost::asio::steady_timer upstream_timer_;
+    boost::asio::steady_timer drain_timer_;
     Logger& logger_;
 
+    // Запросы, ожидающие ответа форвард-сервера, по upstream ID
+    std::unordered_map<uint16_t, std::shared_ptr<QueryContext>>
+        upstream_queries_;
+    std::deque<uint16_t> free_upstream_ids_;
+
+    // Принятые и ещё не завершённые запросы (включая отправку ответа клиенту)
+    size_t pending_queries_{0};
+    bool draining_{false};
+    size_t drain_answered_{0};
+    size_t drain_failed_{0};
+    DrainHandler drain_handler_;
+
     void receive() {
         data_.fill(0);
 
         socket_.async_receive_from(
             boost::asio::buffer(data_, MAX_DNS_PACKET_SIZE), sender_endpoint_,
             [this](boost::system::error_code ec, std::size_t bytes_recvd) {
+                // Во время drain новые запросы не принимаются
+                if (draining_ || ec == boost::asio::error::operation_aborted) {
+                    return;
+                }
                 if (!ec && bytes_recvd > 0) {
                     handleRequest(bytes_recvd);
                 }
@@ -79,12 +158,33 @@ class DNSServer {
 
     void handleRequest(std::size_t bytes_recvd);
 
-    void startReceiveResponse(std::shared_ptr<QueryContext> context);
-    void handleResponse(
-        std::shared_ptr<QueryContext> context,
-        std::shared_ptr<std::array<uint8_t, MAX_DNS_PACKET_SIZE>>
-            response_buffer,
-        std::size_t bytes_transferred);
+    // Выдаёт свободный upstream ID из очереди свободных. Возвращает false,
+    // если в полёте уже 65536 запросов
+    bool allocateUpstreamId(uint16_t& id);
+
+    // Удаляет запрос из ожидающих ответа и возвращает его ID в очередь
+    // свободных
+    std::unordered_map<uint16_t, std::shared_ptr<QueryContext>>::iterator
+    eraseUpstreamQuery(
+        std::unordered_map<uint16_t, std::shared_ptr<QueryContext>>::iterator
+            it);
+
+    // Удаляет запрос из ожидающих ответа. Возвращает false, если он уже
+    // завершён (например, по таймауту)
+    bool releaseUpstreamQuery(const std::shared_ptr<QueryContext>& context);
+
+    // Учитывает завершение запроса: answered - клиент получил ответ
+    void finishQuery(bool answered);
+    void completeDrain();
+
+    // Единственный цикл приёма ответов форвард-сервера; ответ сопоставляется
+    // с запросом по upstream ID
+    void receiveUpstream();
+    void handleResponse(std::size_t bytes_transferred);
+
+    // Периодически завершает запросы, не получившие ответа за
+    // UPSTREAM_TIMEOUT
+    void sweepUpstream();
 
     class DNSNameExtractor {
        private:
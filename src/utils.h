@@ -1,10 +1,17 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <pthread.h>
+#include <sched.h>
 #include <yaml-cpp/yaml.h>
 
+#include <cctype>
 #include <chrono>
+#include <filesystem>
 #include <iomanip>
+#include <set>
+#include <sstream>
+#include <vector>
 
 class ConfigurateException : public std::exception {
    public:
@@ -20,25 +27,130 @@ class ConfigurateException : public std::exception {
     std::string message_;
 };
 
+// Порт форвард-сервера по умолчанию
+constexpr uint16_t DEFAULT_DNS_SERVER_PORT = 53;
+
+// Время ожидания незавершённых запросов при остановке (в миллисекундах)
+constexpr size_t DEFAULT_DRAIN_TIMEOUT = 5000;
+
+// Время на запись оставшихся в очереди сообщений лога при остановке
+// (в миллисекундах)
+constexpr size_t DEFAULT_LOG_FLUSH_TIMEOUT = 2000;
+
 struct ServerConfiguration {
     std::string base_filename;
     size_t max_log_size;
     uint16_t port;
     std::string base_dns_ip;
+    uint16_t dns_server_port;
+    size_t drain_timeout;
+    size_t log_flush_timeout;
+    std::vector<int> server_cpus;  // Пустой список - без привязки к CPU
+    std::vector<int> logger_cpus;
 
     ServerConfiguration()
-        : base_filename(""), max_log_size(0), port(0), base_dns_ip("") {}
+        : base_filename(""),
+          max_log_size(0),
+          port(0),
+          base_dns_ip(""),
+          dns_server_port(DEFAULT_DNS_SERVER_PORT),
+          drain_timeout(DEFAULT_DRAIN_TIMEOUT),
+          log_flush_timeout(DEFAULT_LOG_FLUSH_TIMEOUT) {}
     ServerConfiguration(const std::string& base_filename, size_t max_log_size,
                         uint16_t port, const std::string& base_dns_ip)
         : base_filename(base_filename),
           max_log_size(max_log_size),
           port(port),
-          base_dns_ip(base_dns_ip) {}
+          base_dns_ip(base_dns_ip),
+          dns_server_port(DEFAULT_DNS_SERVER_PORT),
+          drain_timeout(DEFAULT_DRAIN_TIMEOUT),
+          log_flush_timeout(DEFAULT_LOG_FLUSH_TIMEOUT) {}
 };
 
 void parseServerConfiguration(ServerConfiguration& p_conf,
                               const std::string& conf_filename);
 
+// Привязывает текущий поток к набору CPU. Память, которую поток после этого
+// заполняет впервые, выделяется на NUMA-узле этих CPU (first-touch)
+inline bool pinCurrentThread(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return true;
+    }
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            return false;
+        }
+        CPU_SET(cpu, &cpu_set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) ==
+           0;
+#else
+    return false;
+#endif
+}
+
+// Набор CPU, на которых может выполняться текущий поток (пустой, если его
+// не удалось получить)
+inline std::vector<int> getCurrentThreadAffinity() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) !=
+        0) {
+        return cpus;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &cpu_set)) {
+            cpus.push_back(cpu);
+        }
+    }
+#endif
+    return cpus;
+}
+
+// Описание набора CPU для вывода при старте, например
+// "CPUs 2,3 (NUMA node 0)"
+inline std::string describeCpuSet(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return "any CPU (not pinned)";
+    }
+
+    std::stringstream ss;
+    std::set<int> nodes;
+    ss << "CPUs ";
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        ss << (i > 0 ? "," : "") << cpus[i];
+
+        // Узел CPU виден в sysfs как каталог cpuN/nodeM
+        std::error_code ec;
+        std::filesystem::directory_iterator it(
+            "/sys/devices/system/cpu/cpu" + std::to_string(cpus[i]), ec);
+        for (; !ec && it != std::filesystem::directory_iterator();
+             it.increment(ec)) {
+            std::string name = it->path().filename().string();
+            if (name.rfind("node", 0) == 0 && name.size() > 4 &&
+                std::isdigit(static_cast<unsigned char>(name[4]))) {
+                nodes.insert(std::stoi(name.substr(4)));
+            }
+        }
+    }
+
+    if (!nodes.empty()) {
+        ss << (nodes.size() == 1 ? " (NUMA node " : " (NUMA nodes ");
+        bool first = true;
+        for (int node : nodes) {
+            ss << (first ? "" : ",") << node;
+            first = false;
+        }
+        ss << ")";
+    }
+    return ss.str();
+}
+
 inline std::stringstream& getCookedLogString(std::stringstream& ss) {
     auto now = std::chrono::system_clock::now();
     auto time = std::chrono::system_clock::to_time_t(now);